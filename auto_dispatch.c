@@ -0,0 +1,98 @@
+/* Test script of OpenGL Shader Language for General Purpose Computing
+ *
+ * This code calibrates the CPU/GPU cost model (or loads it from the cache
+ * file), then runs saxpy and max reduction over problem sizes spanning six
+ * orders of magnitude. For each size it prints the predicted and measured
+ * times of both sides and which side the dispatcher picks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+#include "dispatch.h"
+
+static double wallTime()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+int main(int argc, char **argv) {
+    /* command line parameters */
+    int iterations;                 // saxpy iterations
+    const char* cacheFile;          // cost model cache, "-" to always calibrate
+    /* application variables */
+    Dispatcher d;
+    double start;
+
+    /* parse command line ***********/
+    if (argc < 3) {
+        printf("Command line parameters:\n");
+        printf("Param 1: number of saxpy iterations\n");
+        printf("Param 2: cost model cache file, - to recalibrate without cache\n");
+        exit(0);
+    } else {
+        iterations = atoi(argv[1]);
+        cacheFile = strcmp(argv[2], "-") ? argv[2] : NULL;
+        printf("numIter=%d, cache=%s\n", iterations, cacheFile ? cacheFile : "(none)");
+    }
+
+    /* initialize system ************/
+    GLuint hwnd = initGlut(&argc, argv);
+    start = wallTime();
+    if (initDispatcher(&d, cacheFile))
+        printf("GPU unavailable, running on CPU only\n");
+    printf("Cost model ready in %f s for %s\n", wallTime()-start, d.model.renderer);
+    printf("upload %e + %e/float, readback %e + %e/float, pass %e\n",
+           d.model.uploadFixed, d.model.uploadPerFloat, d.model.readFixed, d.model.readPerFloat, d.model.passFixed);
+
+    /* run over sizes ***************/
+    const int maxN = 1000000;
+    float* x = (float*)malloc(maxN*sizeof(float));
+    float* y = (float*)malloc(maxN*sizeof(float));
+    float* yCpu = (float*)malloc(maxN*sizeof(float));
+    srand(0);
+    for (int i=0; i<maxN; i++)
+        x[i] = rand() / (double)(RAND_MAX);
+
+    printf("kernel\tN\tCPU est\t\tCPU real\tGPU est\t\tGPU real\tpick\tmax error\n");
+    for (int n=1; n<=maxN; n*=10) {
+        double cpuReal, gpuReal, err = 0.0;
+        int gpu;
+        // saxpy, both sides then dispatched
+        for (int i=0; i<n; i++) y[i] = yCpu[i] = x[(i*7) % n];
+        start = wallTime();
+        saxpyCpu(1.0/9.0, x, yCpu, n, iterations);
+        cpuReal = wallTime()-start;
+        start = wallTime();
+        gpuReal = saxpyGpu(&d, 1.0/9.0, x, y, n, iterations) ? HUGE_VAL : wallTime()-start;
+        for (int i=0; i<n; i++) y[i] = x[(i*7) % n];
+        gpu = dispatchSaxpy(&d, 1.0/9.0, x, y, n, iterations);
+        for (int i=0; i<n; i++)
+            err = fmax(err, fabs(y[i]-yCpu[i]));
+        printf("saxpy\t%d\t%e\t%e\t%e\t%e\t%s\t%e\n", n,
+               estimateSaxpy(&d, n, iterations, 0), cpuReal,
+               estimateSaxpy(&d, n, iterations, 1), gpuReal, gpu ? "GPU" : "CPU", err);
+        // max reduction, both sides then dispatched
+        float cpuMax, gpuMax;
+        start = wallTime();
+        cpuMax = maxReduceCpu(x, n);
+        cpuReal = wallTime()-start;
+        start = wallTime();
+        gpuReal = maxReduceGpu(&d, x, n, &gpuMax) ? HUGE_VAL : wallTime()-start;
+        gpu = dispatchMaxReduce(&d, x, n, &gpuMax);
+        printf("max\t%d\t%e\t%e\t%e\t%e\t%s\t%e\n", n,
+               estimateMaxReduce(&d, n, 0), cpuReal,
+               estimateMaxReduce(&d, n, 1), gpuReal, gpu ? "GPU" : "CPU", fabs(gpuMax-cpuMax));
+    };
+
+    /* clean up **********************/
+    cleanupDispatcher(&d);
+    glutDestroyWindow(hwnd);
+    free(x); free(y); free(yCpu);
+    // exit
+    return 0;
+}
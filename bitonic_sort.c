@@ -0,0 +1,111 @@
+/* Test script of OpenGL Shader Language for General Purpose Computing
+ *
+ * This code allocates 2^k x 2^k (key, value) pairs of random keys, sorts them
+ * on the GPU with a bitonic sorting network, then reports the top-k and a few
+ * percentiles by reading back only the texels needed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <assert.h>
+#include "glsl_utils.h"
+
+static int cmpDescending(const void* a, const void* b)
+{
+    float x = *(const float*)a, y = *(const float*)b;
+    return (x < y) - (x > y);
+}
+
+int main(int argc, char **argv) {
+    /* command line parameters */
+    int k;                          // Exponent
+    int size;                       // 2^k
+    int topK;                       // number of largest keys to report
+    /* application variables */
+    float *data, *keys;             // (key,value) texels and CPU copy of keys
+    double start, end;              // for timing
+    GLuint fb, prog;                // FBO handle and program handle
+    GLuint tex[2];                  // textures handle
+
+    /* parse command line ***********/
+    if (argc < 3) {
+        printf("Command line parameters:\n");
+        printf("Param 1: exponent k\n");
+        printf("Param 2: number of top keys to report\n");
+        exit(0);
+    } else {
+        k = atoi(argv[1]);
+        size = 0x01 << k;
+        topK = atoi(argv[2]);
+        if (topK > size*size) topK = size*size;
+        if (topK < 0) topK = 0;
+        printf("k=%d, 2^k=%d, top=%d\n", k, size, topK);
+    }
+
+    /* setup parameters *************/
+    // key in first channel, original position as value in second channel
+    setGlFormats(GL_TEXTURE_RECTANGLE_ARB, GL_RGBA32F_ARB, GL_RGBA, 4);
+    data = (float*)malloc(size*size*floatPerTexel*sizeof(float));
+    keys = (float*)malloc(size*size*sizeof(float));
+    srand(0);
+    for (int i=0; i<size*size; i++) {
+        keys[i] = rand() / ((float)rand()+1.0);
+        data[i*floatPerTexel+0] = keys[i];
+        data[i*floatPerTexel+1] = i;
+        data[i*floatPerTexel+2] = 0.0;
+        data[i*floatPerTexel+3] = 0.0;
+    }
+
+    /* initialize system ************/
+    GLuint hwnd = initGlut(&argc, argv);
+    float* dataWrap[] = {data, NULL};
+    GLuint fbo = setupFBO(size, size, dataWrap, 2, &fb, tex);
+    assert(fbo == fb);
+    prog = createProgram(NULL, "bitonic_sort.f.glsl");
+    glFinish();
+
+    /* sort on GPU ******************/
+    start = clock();
+    int sortPos = bitonicSort(prog, size, size, tex, 0, 1);
+    glFinish();
+    if (sortPos < 0) exit(1);
+    end = clock();
+    printf("GPU sort time (s):\t\t%f\n", (end-start)/CLOCKS_PER_SEC);
+
+    /* sort on CPU for verification */
+    start = clock();
+    qsort(keys, size*size, sizeof(float), cmpDescending);
+    end = clock();
+    printf("CPU sort time (s):\t\t%f\n", (end-start)/CLOCKS_PER_SEC);
+
+    /* top-k, read back only the leading rows */
+    float* top = (float*)malloc(topK*floatPerTexel*sizeof(float));
+    readFBOLinear(ATTACHMENTPOINT[sortPos], size, 0, topK, top);
+    printf("Rank\tGPU key\t\tindex\tCPU key\n");
+    for (int i=0; i<topK; i++) {
+        printf("%d\t%f\t%d\t%f\n", i+1, top[i*floatPerTexel], (int)top[i*floatPerTexel+1], keys[i]);
+    };
+    free(top);
+
+    /* percentiles, one texel each; sorted descending so flip p */
+    const double pct[] = {0.5, 0.9, 0.99};
+    float texel[4];
+    for (unsigned i=0; i<sizeof(pct)/sizeof(pct[0]); i++) {
+        float v = sortedPercentile(ATTACHMENTPOINT[sortPos], size, size, 1.0-pct[i], texel);
+        unsigned idx = (unsigned)floor((1.0-pct[i]) * (size*size-1) + 0.5);
+        printf("P%-5g GPU = %f\tCPU = %f\n", pct[i]*100, v, keys[idx]);
+    };
+    checkGLStatus();
+
+    /* clean up **********************/
+    glDeleteProgram(prog);
+    cleanupFBO(&fb, tex, 2);
+    glutDestroyWindow (hwnd);
+    free(data);
+    free(keys);
+    // exit
+    return 0;
+}
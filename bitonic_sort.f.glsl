@@ -0,0 +1,33 @@
+#extension GL_ARB_texture_rectangle : enable
+
+uniform sampler2DRect texture;
+uniform float width;        // texture width, to linearize texel position
+uniform float stage;        // size of bitonic sequences being merged, k = 2,4,8,...
+uniform float pass;         // compare distance within the stage, j = k/2,...,2,1
+uniform float descending;   // 0 = sort ascending, 1 = sort descending
+
+/* One compare-exchange step of the bitonic network. Each texel holds a
+ * (key, value, -, -) tuple and the key is in the first channel. The texel at
+ * linear position i pairs with the texel at i XOR j and keeps either the min
+ * or the max of the two depending on its position in the network. GLSL 1.20
+ * has no integer bitwise ops, so bits are tested with floor/mod.
+ */
+void main(void)
+{
+    vec2 pos = floor(gl_TexCoord[0].st);
+    float i = pos.y * width + pos.x;
+    bool lower = mod(floor(i / pass), 2.0) < 0.5;
+    float partner = lower ? i + pass : i - pass;
+    vec2 ppos = vec2(mod(partner, width), floor(partner / width)) + vec2(0.5, 0.5);
+
+    vec4 self  = texture2DRect(texture, gl_TexCoord[0].st);
+    vec4 other = texture2DRect(texture, ppos);
+
+    bool ascending = mod(floor(i / stage), 2.0) < 0.5;
+    if (descending > 0.5) ascending = !ascending;
+    bool keepMin = (lower == ascending);
+    bool swap = keepMin ? (other.x < self.x) : (other.x > self.x);
+    gl_FragColor = swap ? other : self;
+}
+
+/* vim:set syntax=glsl sw=4 ts=4 bs=indent: */
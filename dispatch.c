@@ -0,0 +1,427 @@
+/*
+ * Automatic CPU/GPU dispatch for the saxpy and max reduction kernels
+ *
+ * A short calibration measures the transfer and render pass costs of the GPU
+ * and the throughput of the CPU, or loads them from a cache file. Each call
+ * is then routed to whichever side the cost model predicts to be faster for
+ * its size and iteration count.
+ */
+
+#include "dispatch.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+#include <sys/time.h>
+
+/** Wall clock time in seconds, clock() does not count time blocked in glFinish */
+static double wallTime()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+/** Fit t = fixed + slope*n through two measurements, clamped to nonnegative */
+static void fitLine(double n1, double t1, double n2, double t2, double* fixed, double* slope)
+{
+	*slope = (t2 > t1) ? (t2-t1)/(n2-n1) : 0.0;
+	*fixed = t1 - *slope*n1;
+	if (*fixed < 0.0) *fixed = 0.0;
+}
+
+/** Side of the smallest power-of-2 square texture holding n floats */
+static GLsizei pow2Side(int n)
+{
+	GLsizei side = 1;
+	while ((double)side*side < n) side <<= 1;
+	return side;
+}
+
+/** Run y = x + alpha*y for a number of iterations, as in linear_mapping.c
+ *  @param tex three textures attached to the bound FBO: tex[1] holds y,
+ *         tex[2] holds x and tex[0] is the ping-pong buffer
+ *  @return index into tex holding the result
+ */
+static int saxpyPasses(Dispatcher* d, GLsizei side, GLuint* tex, float alpha, int iterations)
+{
+	int writePos = 0;
+	glUseProgram(d->saxpyProg);
+	glUniform1f(glGetUniformLocation(d->saxpyProg, "alpha"), alpha);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(texTarget, tex[2]);
+	glUniform1i(glGetUniformLocation(d->saxpyProg, "textureX"), 1);
+	glActiveTexture(GL_TEXTURE0);
+	glUniform1i(glGetUniformLocation(d->saxpyProg, "textureY"), 0);
+	for (int i=0; i<iterations; i++) {
+		glDrawBuffer(ATTACHMENTPOINT[writePos]);
+		glBindTexture(texTarget, tex[1-writePos]);
+		render(side, side);
+		writePos = 1-writePos;
+	};
+	return 1-writePos;
+}
+
+/** Find the maximum by repeated 2x2 reduction, as in max_reduce.c
+ *  @param side texture side, power of 2
+ *  @param tex two textures attached to the bound FBO, tex[1] holds the data
+ *  @return index into tex holding the result at texel (0,0)
+ */
+static int reducePasses(Dispatcher* d, GLsizei side, GLuint* tex)
+{
+	int writePos = 0;
+	GLint texParam   = glGetUniformLocation(d->reduceProg, "texture");
+	GLint deltaParam = glGetUniformLocation(d->reduceProg, "delta");
+	glUseProgram(d->reduceProg);
+	glActiveTexture(GL_TEXTURE1);
+	glUniform1i(texParam, 1);
+	for (GLsizei outSize = side>>1; outSize; outSize >>= 1) {
+		glUniform1f(deltaParam, outSize);
+		glBindTexture(texTarget, tex[1-writePos]);
+		glDrawBuffer(ATTACHMENTPOINT[writePos]);
+		render(outSize, outSize);
+		writePos = 1-writePos;
+	};
+	glActiveTexture(GL_TEXTURE0);
+	return 1-writePos;
+}
+
+/** Prepare the dispatcher: create the GPU programs and get the cost model
+ *  Needs a GL context, i.e. call after initGlut().
+ *  @param d the dispatcher to initialize
+ *  @param cacheFile file to load the cost model from and save it to after
+ *         calibration, or NULL to always calibrate
+ *  GPU calls run in a scratch FBO, so the caller's FBO, viewport and
+ *  matrices are left as they were. The kernels pack one float per texel, so
+ *  while setGlFormats() selects more than one, all calls run on CPU.
+ *  @return 0 if ready
+ *  @return 1 if a GPU kernel is unusable, calls to it will run on CPU
+ */
+int initDispatcher(Dispatcher* d, const char* cacheFile)
+{
+	const char* renderer = (const char*)glGetString(GL_RENDERER);
+	memset(d, 0, sizeof(Dispatcher));
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &d->maxTexSize);
+	d->saxpyProg  = createProgram(NULL, "linear_mapping.f.glsl");
+	d->reduceProg = createProgram(NULL, "max_reduce.f.glsl");
+	if (cacheFile && !loadCostModel(&d->model, cacheFile)
+	    && renderer && !strcmp(d->model.renderer, renderer)) {
+		return (d->saxpyProg && d->reduceProg && 1 == floatPerTexel) ? 0 : 1;
+	};
+	if (calibrate(d)) {
+		cleanupDispatcher(d);
+		return 1;
+	};
+	if (cacheFile) saveCostModel(&d->model, cacheFile);
+	return 0;
+}
+
+/** Release the GPU programs of the dispatcher */
+void cleanupDispatcher(Dispatcher* d)
+{
+	if (d->saxpyProg) glDeleteProgram(d->saxpyProg);
+	if (d->reduceProg) glDeleteProgram(d->reduceProg);
+	d->saxpyProg = d->reduceProg = 0;
+}
+
+/** Measure the cost model on this machine
+ *  Each GPU cost is measured at two texture sizes and fitted to a fixed
+ *  overhead plus a cost per float, taking the best of a few repetitions.
+ *  @return 0 if calibrated
+ *  @return 1 otherwise with error message print to stderr
+ */
+int calibrate(Dispatcher* d)
+{
+	const GLsizei side[2] = {64, 512};
+	const int reps = 3;
+	const int passes = 16;
+	double up[2], down[2], pass[2], t0, t1, t2, t3;
+	CostModel* m = &d->model;
+	const int n = side[1]*side[1];
+	float *x, *y, *out;
+	int err = 1;
+
+	if (!d->saxpyProg || !d->reduceProg || side[1] > d->maxTexSize || floatPerTexel != 1) {
+		fprintf(stderr, "calibrate: GPU kernels not available\n");
+		return 1;
+	};
+	x = (float*)malloc(n*sizeof(float));
+	y = (float*)malloc(n*sizeof(float));
+	out = (float*)malloc(n*sizeof(float));
+	if (!x || !y || !out) goto EXIT;
+	for (int i=0; i<n; i++) {
+		x[i] = (i % 97) / 97.0;
+		y[i] = (i % 89) / 89.0;
+	};
+	memset(m, 0, sizeof(CostModel));
+	const char* renderer = (const char*)glGetString(GL_RENDERER);
+	if (!renderer) goto EXIT;
+	strncpy(m->renderer, renderer, sizeof(m->renderer)-1);
+
+	/* upload, saxpy passes and readback at two sizes */
+	for (int s=0; s<2; s++) {
+		up[s] = down[s] = pass[s] = HUGE_VAL;
+		for (int r=0; r<reps; r++) {
+			GLuint fb, tex[3];
+			GLint saved[2];
+			float* data[] = {NULL, y, x};
+			glFinish();
+			t0 = wallTime();
+			if (beginScratchFBO(side[s], side[s], data, 3, &fb, tex, saved)) {
+				endScratchFBO(saved, &fb, tex, 3);
+				goto EXIT;
+			};
+			glFinish();
+			t1 = wallTime();
+			int readPos = saxpyPasses(d, side[s], tex, 0.5, passes);
+			glFinish();
+			t2 = wallTime();
+			readFBO(ATTACHMENTPOINT[readPos], side[s], side[s], out);
+			t3 = wallTime();
+			endScratchFBO(saved, &fb, tex, 3);
+			up[s]   = fmin(up[s], t1-t0);
+			pass[s] = fmin(pass[s], (t2-t1)/passes);
+			down[s] = fmin(down[s], t3-t2);
+		};
+	};
+	const double n1 = (double)side[0]*side[0];
+	const double n2 = (double)side[1]*side[1];
+	fitLine(2*n1, up[0], 2*n2, up[1], &m->uploadFixed, &m->uploadPerFloat);	// x and y uploaded
+	fitLine(n1, down[0], n2, down[1], &m->readFixed, &m->readPerFloat);
+	fitLine(n1, pass[0], n2, pass[1], &m->passFixed, &m->saxpyGpu);
+
+	/* reduction passes at the larger size */
+	double reduce = HUGE_VAL;
+	int levels = 0;
+	for (GLsizei s = side[1]>>1; s; s >>= 1) levels++;
+	for (int r=0; r<reps; r++) {
+		GLuint fb, tex[2];
+		GLint saved[2];
+		float* data[] = {NULL, x};
+		if (beginScratchFBO(side[1], side[1], data, 2, &fb, tex, saved)) {
+			endScratchFBO(saved, &fb, tex, 2);
+			goto EXIT;
+		};
+		glFinish();
+		t0 = wallTime();
+		reducePasses(d, side[1], tex);
+		glFinish();
+		t1 = wallTime();
+		endScratchFBO(saved, &fb, tex, 2);
+		reduce = fmin(reduce, t1-t0);
+	};
+	m->reduceGpu = fmax(0.0, reduce - levels*m->passFixed) / n2;
+
+	/* CPU throughput */
+	double cpu = HUGE_VAL;
+	for (int r=0; r<reps; r++) {
+		t0 = wallTime();
+		saxpyCpu(0.5, x, y, n, passes);
+		cpu = fmin(cpu, wallTime()-t0);
+	};
+	m->saxpyCpu = cpu / ((double)n*passes);
+	cpu = HUGE_VAL;
+	for (int r=0; r<reps; r++) {
+		t0 = wallTime();
+		volatile float sink = maxReduceCpu(x, n);
+		(void)sink;
+		cpu = fmin(cpu, wallTime()-t0);
+	};
+	m->reduceCpu = cpu / n;
+	err = checkGLStatus();
+EXIT:
+	if (err) fprintf(stderr, "calibrate: measurement failed\n");
+	free(x); free(y); free(out);
+	return err;
+}
+
+/** Load a cost model saved by saveCostModel()
+ *  @return 0 if loaded
+ *  @return 1 if the file is missing or malformed
+ */
+int loadCostModel(CostModel* m, const char* filename)
+{
+	char line[sizeof(m->renderer)+16];
+	int ok = 0;
+	FILE* fp = fopen(filename, "r");
+	if (!fp) return 1;
+	memset(m, 0, sizeof(CostModel));
+	if (fgets(line, sizeof(line), fp) && !strncmp(line, "renderer ", 9)) {
+		line[strcspn(line, "\n")] = '\0';
+		strncpy(m->renderer, line+9, sizeof(m->renderer)-1);
+		ok = (9 == fscanf(fp, " upload %lf %lf readback %lf %lf pass %lf saxpy %lf %lf reduce %lf %lf",
+		                  &m->uploadFixed, &m->uploadPerFloat, &m->readFixed, &m->readPerFloat,
+		                  &m->passFixed, &m->saxpyGpu, &m->saxpyCpu, &m->reduceGpu, &m->reduceCpu));
+	};
+	fclose(fp);
+	return !ok;
+}
+
+/** Save the cost model as text
+ *  @return 0 if saved
+ *  @return 1 otherwise
+ */
+int saveCostModel(const CostModel* m, const char* filename)
+{
+	FILE* fp = fopen(filename, "w");
+	if (!fp) {
+		fprintf(stderr, "Error opening %s: ", filename); perror("");
+		return 1;
+	};
+	fprintf(fp, "renderer %s\n", m->renderer);
+	fprintf(fp, "upload %e %e\n", m->uploadFixed, m->uploadPerFloat);
+	fprintf(fp, "readback %e %e\n", m->readFixed, m->readPerFloat);
+	fprintf(fp, "pass %e\n", m->passFixed);
+	fprintf(fp, "saxpy %e %e\n", m->saxpyGpu, m->saxpyCpu);
+	fprintf(fp, "reduce %e %e\n", m->reduceGpu, m->reduceCpu);
+	return fclose(fp) ? 1 : 0;
+}
+
+/** Predicted time of saxpy in seconds, HUGE_VAL if it cannot run on GPU
+ *  @param gpu nonzero for the GPU estimate, zero for the CPU estimate
+ */
+double estimateSaxpy(const Dispatcher* d, int n, int iterations, int gpu)
+{
+	const CostModel* m = &d->model;
+	if (!gpu) return m->saxpyCpu * n * iterations;
+	if (n <= 0) return HUGE_VAL;
+	GLsizei side = (GLsizei)ceil(sqrt((double)n));
+	if (!d->saxpyProg || side > d->maxTexSize || floatPerTexel != 1) return HUGE_VAL;
+	double size = (double)side*side;
+	// readFBOLinear() reads back only the n texels: whole rows and a partial last row
+	int reads = (n >= side ? 1 : 0) + (n % side ? 1 : 0);
+	return m->uploadFixed + 2*size*m->uploadPerFloat
+	     + iterations*(m->passFixed + size*m->saxpyGpu)
+	     + reads*m->readFixed + (double)n*m->readPerFloat;
+}
+
+/** Predicted time of max reduction in seconds, HUGE_VAL if it cannot run on GPU
+ *  @param gpu nonzero for the GPU estimate, zero for the CPU estimate
+ */
+double estimateMaxReduce(const Dispatcher* d, int n, int gpu)
+{
+	const CostModel* m = &d->model;
+	if (!gpu) return m->reduceCpu * n;
+	GLsizei side = pow2Side(n);
+	if (!d->reduceProg || side > d->maxTexSize || floatPerTexel != 1) return HUGE_VAL;
+	int levels = 0;
+	for (GLsizei s = side>>1; s; s >>= 1) levels++;
+	double size = (double)side*side;
+	return m->uploadFixed + size*m->uploadPerFloat
+	     + levels*m->passFixed + size*m->reduceGpu
+	     + m->readFixed + m->readPerFloat;
+}
+
+/** Compute y = x + alpha*y for a number of iterations on CPU */
+void saxpyCpu(float alpha, const float* x, float* y, int n, int iterations)
+{
+	for (int i=0; i<n; i++)
+		for (int k=0; k<iterations; k++)
+			y[i] = x[i] + alpha*y[i];
+}
+
+/** Compute y = x + alpha*y for a number of iterations on GPU
+ *  @return 0 on success
+ *  @return 1 if it cannot run on GPU, y is left untouched
+ */
+int saxpyGpu(Dispatcher* d, float alpha, const float* x, float* y, int n, int iterations)
+{
+	GLsizei side;
+	int size;
+	float *px = (float*)x, *py = y;
+	GLuint fb, tex[3];
+	GLint saved[2];
+	int err = 1;
+
+	if (n <= 0) return 1;
+	side = (GLsizei)ceil(sqrt((double)n));
+	size = side*side;
+	if (!d->saxpyProg || side > d->maxTexSize || floatPerTexel != 1) return 1;
+	if (size != n) {
+		// pad to a square texture
+		px = (float*)calloc(size, sizeof(float));
+		py = (float*)calloc(size, sizeof(float));
+		if (!px || !py) goto EXIT;
+		memcpy(px, x, n*sizeof(float));
+		memcpy(py, y, n*sizeof(float));
+	};
+	float* data[] = {NULL, py, px};
+	if (!beginScratchFBO(side, side, data, 3, &fb, tex, saved)) {
+		int readPos = saxpyPasses(d, side, tex, alpha, iterations);
+		// read only the n texels of y, straight into place
+		if (!(err = checkGLStatus()))
+			readFBOLinear(ATTACHMENTPOINT[readPos], side, 0, n, y);
+	};
+	endScratchFBO(saved, &fb, tex, 3);
+EXIT:
+	if (size != n) {
+		free(px);
+		free(py);
+	};
+	return err;
+}
+
+/** Compute y = x + alpha*y on whichever of CPU or GPU is predicted faster
+ *  @return 1 if run on GPU, 0 if run on CPU
+ */
+int dispatchSaxpy(Dispatcher* d, float alpha, const float* x, float* y, int n, int iterations)
+{
+	if (estimateSaxpy(d, n, iterations, 1) < estimateSaxpy(d, n, iterations, 0)
+	    && !saxpyGpu(d, alpha, x, y, n, iterations))
+		return 1;
+	saxpyCpu(alpha, x, y, n, iterations);
+	return 0;
+}
+
+/** Find the maximum of an array on CPU */
+float maxReduceCpu(const float* data, int n)
+{
+	float result = -FLT_MAX;
+	for (int i=0; i<n; i++)
+		if (data[i] > result) result = data[i];
+	return result;
+}
+
+/** Find the maximum of an array on GPU
+ *  @return 0 on success
+ *  @return 1 if it cannot run on GPU
+ */
+int maxReduceGpu(Dispatcher* d, const float* data, int n, float* result)
+{
+	GLsizei side = pow2Side(n);
+	const int size = side*side;
+	float* padded;
+	GLuint fb, tex[2];
+	GLint saved[2];
+	int err = 1;
+
+	if (!d->reduceProg || side > d->maxTexSize || floatPerTexel != 1) return 1;
+	// pad to a power-of-2 square texture with values that never win
+	if (0 == (padded = (float*)malloc(size*sizeof(float)))) return 1;
+	memcpy(padded, data, n*sizeof(float));
+	for (int i=n; i<size; i++) padded[i] = -FLT_MAX;
+	float* dataWrap[] = {NULL, padded};
+	if (!beginScratchFBO(side, side, dataWrap, 2, &fb, tex, saved)) {
+		int readPos = reducePasses(d, side, tex);
+		if (!(err = checkGLStatus()))
+			readFBO(ATTACHMENTPOINT[readPos], 1, 1, result);
+	};
+	endScratchFBO(saved, &fb, tex, 2);
+	free(padded);
+	return err;
+}
+
+/** Find the maximum of an array on whichever of CPU or GPU is predicted faster
+ *  @return 1 if run on GPU, 0 if run on CPU
+ */
+int dispatchMaxReduce(Dispatcher* d, const float* data, int n, float* result)
+{
+	if (estimateMaxReduce(d, n, 1) < estimateMaxReduce(d, n, 0)
+	    && !maxReduceGpu(d, data, n, result))
+		return 1;
+	*result = maxReduceCpu(data, n);
+	return 0;
+}
+
+/* vim:set noet sw=4 ts=4 bs=indent,eol,start syntax=c: */
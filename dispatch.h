@@ -0,0 +1,48 @@
+#ifndef _DISPATCH_H
+#define _DISPATCH_H
+
+#include "glsl_utils.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Cost model of running a kernel on CPU or GPU, all times in seconds. A GPU
+ * call costs an upload, a number of render passes and a readback; each of
+ * them is modelled as a fixed overhead plus a cost per float. */
+typedef struct {
+	char renderer[128];			// GL_RENDERER the model is calibrated on
+	double uploadFixed, uploadPerFloat;
+	double readFixed, readPerFloat;
+	double passFixed;			// overhead of one render pass
+	double saxpyGpu, saxpyCpu;	// per element per iteration
+	double reduceGpu, reduceCpu;	// per element
+} CostModel;
+
+typedef struct {
+	CostModel model;
+	GLuint saxpyProg;			// from linear_mapping.f.glsl
+	GLuint reduceProg;			// from max_reduce.f.glsl
+	GLint maxTexSize;
+} Dispatcher;
+
+// Functions
+int initDispatcher(Dispatcher* d, const char* cacheFile);
+void cleanupDispatcher(Dispatcher* d);
+int calibrate(Dispatcher* d);
+int loadCostModel(CostModel* m, const char* filename);
+int saveCostModel(const CostModel* m, const char* filename);
+double estimateSaxpy(const Dispatcher* d, int n, int iterations, int gpu);
+double estimateMaxReduce(const Dispatcher* d, int n, int gpu);
+void saxpyCpu(float alpha, const float* x, float* y, int n, int iterations);
+int saxpyGpu(Dispatcher* d, float alpha, const float* x, float* y, int n, int iterations);
+int dispatchSaxpy(Dispatcher* d, float alpha, const float* x, float* y, int n, int iterations);
+float maxReduceCpu(const float* data, int n);
+int maxReduceGpu(Dispatcher* d, const float* data, int n, float* result);
+int dispatchMaxReduce(Dispatcher* d, const float* data, int n, float* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DISPATCH_H */
@@ -0,0 +1,31 @@
+#extension GL_ARB_texture_rectangle : enable
+
+uniform sampler2DRect texture;
+uniform sampler2DRect reference;
+uniform vec2 size;          // valid extent of the input, texels beyond read as 0
+uniform float first;        // 1 = first pass, input is |texture - reference|
+uniform float sum;          // 0 = reduce by max, 1 = reduce by sum
+
+float fetch(vec2 p)
+{
+    if (p.x >= size.x || p.y >= size.y) return 0.0;
+    float v = texture2DRect(texture, p + vec2(0.5, 0.5)).x;
+    if (first > 0.5) v = abs(v - texture2DRect(reference, p + vec2(0.5, 0.5)).x);
+    return v;
+}
+
+/* Reduce each 2x2 block of the input into one texel, so arbitrary sizes
+ * shrink to 1x1 in ceil(log2(max(width,height))) passes. Errors are never
+ * negative, hence 0 is neutral for both max and sum.
+ */
+void main(void)
+{
+    vec2 p = 2.0 * floor(gl_TexCoord[0].st);
+    float v1 = fetch(p);
+    float v2 = fetch(p + vec2(1.0, 0.0));
+    float v3 = fetch(p + vec2(0.0, 1.0));
+    float v4 = fetch(p + vec2(1.0, 1.0));
+    gl_FragColor.x = (sum > 0.5) ? (v1 + v2) + (v3 + v4) : max(max(v1, v2), max(v3, v4));
+}
+
+/* vim:set syntax=glsl sw=4 ts=4 bs=indent: */
@@ -9,6 +9,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#ifdef GLSL_TRACE
+#include <sys/time.h>
+#endif
 
 // Platform dependent formats
 GLenum texTarget = GL_TEXTURE_RECTANGLE_ARB;	// GL_TEXTURE_2D
@@ -17,6 +20,8 @@ GLint texFmt = GL_LUMINANCE;    // GL_RGBA;
 unsigned floatPerTexel = 1;     // 4;
 unsigned usePBO = 0;			// use pixel buffer objects for asynchronus transfer between CPU & GPU
 GLuint _pbo[10];				// PBO handle
+GLuint _pointVBO = 0;			// VBO of texel centres for renderPoints()
+GLsizei _pointWidth = 0, _pointHeight = 0;	// size _pointVBO was built for
 
 // Variables for convenience
 const int ATTACHMENTPOINT[] = {
@@ -251,6 +256,7 @@ GLuint initGlut(int* argcp, char** argv)
 	if (usePBO) {
 		glGenBuffers(10, _pbo);
 	};
+	traceInit();
 	return window;
 }
 
@@ -285,17 +291,7 @@ GLuint setupFBO(GLsizei width, GLsizei height, float**data, const unsigned count
 		if (setupTexture(width, height, tex[i])) goto EXIT;
 		// transfer data to texture
 		if (data[i]) {
-			if (usePBO) {
-				glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, _pbo[i]);
-				glBufferData(GL_PIXEL_UNPACK_BUFFER_ARB, width*height*sizeof(float), NULL, GL_STREAM_DRAW);
-				void* ioMem = glMapBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY);
-				memcpy(ioMem, data[i], width*height*sizeof(float));
-				glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER_ARB);
-				glTexSubImage2D(texTarget, 0, 0, 0, width, height, texFmt, GL_FLOAT, (void*)0);
-				glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
-			} else {
-				glTexSubImage2D(texTarget, 0, 0, 0, width, height, texFmt, GL_FLOAT, data[i]);
-			}
+			uploadTexture(width, height, tex[i], data[i]);
 		};
 	};
 	
@@ -334,6 +330,29 @@ int setupTexture(GLsizei width, GLsizei height, GLuint tex)
 	return checkGLStatus();
 }
 
+/** Transfer data from local memory into a whole texture
+ *  @param width the texture width
+ *  @param height the texture height
+ *  @param tex the texture to fill
+ *  @param data the source, width*height*floatPerTexel floats
+ */
+void uploadTexture(GLsizei width, GLsizei height, GLuint tex, const float*data)
+{
+	const size_t bytes = (size_t)width*height*floatPerTexel*sizeof(float);
+	glBindTexture(texTarget, tex);
+	if (usePBO) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, _pbo[0]);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER_ARB, bytes, NULL, GL_STREAM_DRAW);
+		void* ioMem = glMapBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY);
+		memcpy(ioMem, data, bytes);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER_ARB);
+		glTexSubImage2D(texTarget, 0, 0, 0, width, height, texFmt, GL_FLOAT, (void*)0);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	} else {
+		glTexSubImage2D(texTarget, 0, 0, 0, width, height, texFmt, GL_FLOAT, data);
+	}
+}
+
 /** Read FBO into local memory
  *  @param attachpoint The attachment point to read
  *  @param width Width of the FBO
@@ -342,20 +361,212 @@ int setupTexture(GLsizei width, GLsizei height, GLuint tex)
  */
 void readFBO(GLenum attachpoint, GLsizei width, GLsizei height, float*data)
 {
+	readFBORegion(attachpoint, 0, 0, width, height, data);
+}
+
+/** Read a rectangular region of FBO into local memory
+ *  Only the region is transferred.
+ *  @param attachpoint The attachment point to read
+ *  @param x left of the region
+ *  @param y bottom of the region
+ *  @param width Width of the region
+ *  @param height Height of the region
+ *  @param data The destination, holds width*height*floatPerTexel floats
+ */
+void readFBORegion(GLenum attachpoint, GLint x, GLint y, GLsizei width, GLsizei height, float*data)
+{
+	const size_t bytes = (size_t)width*height*floatPerTexel*sizeof(float);
 	glReadBuffer(attachpoint);
 	if (usePBO) {
 		glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, _pbo[9]);
-		glBufferData(GL_PIXEL_PACK_BUFFER_ARB,width*height*sizeof(float), NULL, GL_STREAM_READ);
-		glReadPixels(0, 0, width, height, texFmt, GL_FLOAT, (void*)0);
+		glBufferData(GL_PIXEL_PACK_BUFFER_ARB, bytes, NULL, GL_STREAM_READ);
+		glReadPixels(x, y, width, height, texFmt, GL_FLOAT, (void*)0);
 		void* ioMem = glMapBuffer(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY);
-		memcpy(data, ioMem, width*height*sizeof(float));
+		memcpy(data, ioMem, bytes);
 		glUnmapBuffer(GL_PIXEL_PACK_BUFFER_ARB);
 		glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0); 
 	} else {
-		glReadPixels(0, 0, width, height, texFmt, GL_FLOAT, data);
+		glReadPixels(x, y, width, height, texFmt, GL_FLOAT, data);
 	}
 }
 
+/** Read a range of texels in row-major linear order, i.e. index = y*width + x
+ *  Only the texels in the range are transferred: a partial first row, the
+ *  whole rows in between and a partial last row, each read in place.
+ *  @param attachpoint The attachment point to read
+ *  @param width Width of the FBO
+ *  @param first linear index of the first texel to read
+ *  @param count number of texels to read
+ *  @param data The destination, holds count*floatPerTexel floats
+ */
+void readFBOLinear(GLenum attachpoint, GLsizei width, unsigned first, unsigned count, float*data)
+{
+	unsigned x = first % width;
+	unsigned y = first / width;
+	if (count && x) {
+		// partial first row
+		unsigned n = (count < width - x) ? count : width - x;
+		readFBORegion(attachpoint, x, y, n, 1, data);
+		data += n*floatPerTexel;
+		count -= n;
+		++y;
+	};
+	if (count >= (unsigned)width) {
+		// whole rows
+		unsigned rows = count / width;
+		readFBORegion(attachpoint, 0, y, width, rows, data);
+		data += rows*width*floatPerTexel;
+		count -= rows*width;
+		y += rows;
+	};
+	if (count) {
+		// partial last row
+		readFBORegion(attachpoint, 0, y, count, 1, data);
+	};
+}
+
+/** Set up a scratch FBO as setupFBO() does, saving the caller's state
+ *  For library code that must not disturb its caller. The caller's FBO
+ *  binding, current program, viewport, draw buffer, matrices, active texture
+ *  unit and texture bindings are restored by endScratchFBO(), which must be
+ *  called whether or not this succeeded.
+ *  @param width the texture width
+ *  @param height the texture height
+ *  @param data array of data to fill into the textures, or NULL to leave all empty
+ *  @param count number of textures, at most 16
+ *  @param fbo pointer to hold the handle to the FBO
+ *  @param tex array to hold the texture ids
+ *  @param saved array of 2 to hold the caller's FBO and program, to pass to endScratchFBO()
+ *  @return 0 if the scratch FBO is ready, 1 otherwise
+ */
+int beginScratchFBO(GLsizei width, GLsizei height, float**data, const unsigned count, GLuint*fbo, GLuint*tex, GLint*saved)
+{
+	float* none[16] = {NULL};
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT, &saved[0]);
+	glGetIntegerv(GL_CURRENT_PROGRAM, &saved[1]);
+	glPushAttrib(GL_VIEWPORT_BIT | GL_COLOR_BUFFER_BIT | GL_TEXTURE_BIT);
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	return setupFBO(width, height, data ? data : none, count, fbo, tex) ? 0 : 1;
+}
+
+/** Release the scratch FBO and restore the state saved by beginScratchFBO()
+ *  The caller's bindings are restored before the scratch FBO and textures
+ *  are deleted, so nothing of the caller's is unbound by the deletion. They
+ *  are deleted directly rather than by cleanupFBO(), which would also drop
+ *  the shared PBOs.
+ */
+void endScratchFBO(const GLint*saved, GLuint*fbo, GLuint*tex, const unsigned count)
+{
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, saved[0]);
+	glUseProgram(saved[1]);
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopMatrix();
+	glPopAttrib();
+	glDeleteFramebuffersEXT(1, fbo);
+	glDeleteTextures(count, tex);
+}
+
+/** Read every stride-th texel in both dimensions of a texture
+ *  The texels are gathered into a small scratch texture on the GPU so that
+ *  only ceil(width/stride) x ceil(height/stride) texels are transferred.
+ *  @param prog the program created from strided_copy.f.glsl
+ *  @param tex the texture to read
+ *  @param width the texture width
+ *  @param height the texture height
+ *  @param stride distance between texels read, in both dimensions
+ *  @param data The destination, holds ceil(width/stride)*ceil(height/stride)*floatPerTexel floats
+ *  @return 0 if no error, 1 otherwise or if stride is smaller than 1
+ */
+int readFBOStrided(GLuint prog, GLuint tex, GLsizei width, GLsizei height, GLsizei stride, float*data)
+{
+	GLsizei w, h;
+	GLuint fb, scratch;
+	GLint saved[2];
+	int err = 1;
+	if (stride < 1)
+		return 1;
+	w = (width + stride - 1) / stride;
+	h = (height + stride - 1) / stride;
+	if (!beginScratchFBO(w, h, NULL, 1, &fb, &scratch, saved)) {
+		glUseProgram(prog);
+		glUniform1f(glGetUniformLocation(prog, "stride"), stride);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(texTarget, tex);
+		glUniform1i(glGetUniformLocation(prog, "texture"), 0);
+		glDrawBuffer(ATTACHMENTPOINT[0]);
+		render(w, h);
+		readFBORegion(ATTACHMENTPOINT[0], 0, 0, w, h, data);
+		err = checkGLStatus();
+	};
+	endScratchFBO(saved, &fb, &scratch, 1);
+	return err;
+}
+
+/** Compare a texture against a reference texture on the GPU
+ *  The absolute differences are reduced to their maximum and their sum by
+ *  2x2 block reduction passes, so only two floats are read back. Textures
+ *  can be of any size; only the first channel is compared.
+ *  @param prog the program created from error_reduce.f.glsl
+ *  @param tex the texture to check
+ *  @param refTex the reference texture, of the same size
+ *  @param width the texture width
+ *  @param height the texture height
+ *  @param maxError holds the maximum absolute error upon complete
+ *  @param avgError holds the average absolute error upon complete
+ *  @return 0 if no error, 1 otherwise
+ */
+int errorStats(GLuint prog, GLuint tex, GLuint refTex, GLsizei width, GLsizei height, double*maxError, double*avgError)
+{
+	GLuint fb, scratch[2];
+	float result[2], texel[4];
+	GLint saved[2];
+	int err = 1;
+	if (!beginScratchFBO((width+1)/2, (height+1)/2, NULL, 2, &fb, scratch, saved)) {
+		GLint sizeParam  = glGetUniformLocation(prog, "size");
+		GLint firstParam = glGetUniformLocation(prog, "first");
+		GLint sumParam   = glGetUniformLocation(prog, "sum");
+		glUseProgram(prog);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(texTarget, refTex);
+		glUniform1i(glGetUniformLocation(prog, "reference"), 1);
+		glActiveTexture(GL_TEXTURE0);
+		glUniform1i(glGetUniformLocation(prog, "texture"), 0);
+		for (int op=0; op<2; ++op) {
+			// op 0 reduces by max, op 1 by sum; the first pass of each takes the difference
+			GLsizei inW = width, inH = height;
+			GLuint in = tex;
+			int writePos = 0;
+			glUniform1f(sumParam, op);
+			glUniform1f(firstParam, 1.0);
+			do {
+				GLsizei outW = (inW+1)/2, outH = (inH+1)/2;
+				glUniform2f(sizeParam, inW, inH);
+				glBindTexture(texTarget, in);
+				glDrawBuffer(ATTACHMENTPOINT[writePos]);
+				render(outW, outH);
+				glUniform1f(firstParam, 0.0);
+				in = scratch[writePos];
+				writePos = 1-writePos;
+				inW = outW;
+				inH = outH;
+			} while (inW > 1 || inH > 1);
+			// a texel holds floatPerTexel floats; the result is in the first
+			readFBORegion(ATTACHMENTPOINT[1-writePos], 0, 0, 1, 1, texel);
+			result[op] = texel[0];
+		};
+		*maxError = result[0];
+		*avgError = result[1] / ((double)width*height);
+		err = checkGLStatus();
+	};
+	endScratchFBO(saved, &fb, scratch, 2);
+	return err;
+}
+
 /** Clean up the framebuffer
  *  @param fbo pointer to the handle of the framebuffer object
  *  @param tex array of pointer to the handle of the texture object
@@ -388,4 +599,570 @@ void render(GLsizei width, GLsizei height)
 	glEnd();
 }
 
+/** Render one point per texel, at the texel centres
+ *  This is the scatter counterpart of render(): the vertex shader fetches the
+ *  texel at gl_Vertex.xy and decides where the point lands. The coordinates
+ *  are kept in a VBO and only rebuilt when the size changes.
+ */
+void renderPoints(GLsizei width, GLsizei height)
+{
+	if (!_pointVBO) {
+		glGenBuffers(1, &_pointVBO);
+	};
+	glBindBuffer(GL_ARRAY_BUFFER, _pointVBO);
+	if (width != _pointWidth || height != _pointHeight) {
+		GLfloat* coord = (GLfloat*)malloc(2*width*height*sizeof(GLfloat));
+		if (!coord) {
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			return;
+		};
+		for (GLsizei y=0; y<height; ++y)
+			for (GLsizei x=0; x<width; ++x) {
+				coord[2*(y*width+x)  ] = x + 0.5;
+				coord[2*(y*width+x)+1] = y + 0.5;
+			};
+		glBufferData(GL_ARRAY_BUFFER, 2*width*height*sizeof(GLfloat), coord, GL_STATIC_DRAW);
+		free(coord);
+		_pointWidth = width;
+		_pointHeight = height;
+	};
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(2, GL_FLOAT, 0, (void*)0);
+	glDrawArrays(GL_POINTS, 0, width*height);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/** Release the VBO kept by renderPoints()
+ */
+void cleanupPoints()
+{
+	if (_pointVBO) {
+		glDeleteBuffers(1, &_pointVBO);
+		_pointVBO = 0;
+		_pointWidth = _pointHeight = 0;
+	};
+}
+
+/** Build a histogram of texture data by scattering points with additive blending
+ *  The counts are rendered into the current draw buffer, which should be a
+ *  bins[0] x bins[1] texture of the bound FBO with the viewport and projection
+ *  set to its size, e.g. as done by setupFBO(). The draw buffer is cleared
+ *  first. Values outside [lower, upper] are not counted; a value equal to
+ *  upper is counted in the last bin.
+ *  @param prog the program created from histogram.v.glsl and histogram.f.glsl
+ *  @param width the input texture width
+ *  @param height the input texture height
+ *  @param texX the input texture for the first dimension
+ *  @param texY the input texture for the second dimension, 0 for 1D histogram
+ *  @param bins number of bins in each dimension, bins[1] is unused for 1D
+ *  @param lower lower bound of range in each dimension
+ *  @param upper upper bound of range in each dimension
+ */
+void histogram(GLuint prog, GLsizei width, GLsizei height, GLuint texX, GLuint texY,
+               const GLsizei* bins, const float* lower, const float* upper)
+{
+	const int joint = (texY != 0);
+	glUseProgram(prog);
+	glUniform2f(glGetUniformLocation(prog, "lower"), lower[0], joint ? lower[1] : 0.0);
+	glUniform2f(glGetUniformLocation(prog, "upper"), upper[0], joint ? upper[1] : 1.0);
+	glUniform2f(glGetUniformLocation(prog, "bins"),  bins[0],  joint ? bins[1]  : 1.0);
+	glUniform1f(glGetUniformLocation(prog, "joint"), joint ? 1.0 : 0.0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(texTarget, texX);
+	glUniform1i(glGetUniformLocation(prog, "textureX"), 0);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(texTarget, joint ? texY : texX);
+	glUniform1i(glGetUniformLocation(prog, "textureY"), 1);
+
+	glClearColor(0.0, 0.0, 0.0, 0.0);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);	// every point adds 1 to its bin
+	renderPoints(width, height);
+	glDisable(GL_BLEND);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+/** Sort a texture of (key, value) texels with a bitonic network
+ *  Each texel of the RGBA texture holds the key in the first channel and the
+ *  payload in the remaining channels. The texels are ordered in row-major
+ *  linear order, i.e. index = y*width + x. The textures tex[0] and tex[1] must
+ *  be attached to ATTACHMENTPOINT[0] and [1] of the bound FBO for ping-pong.
+ *  @param prog the program created from bitonic_sort.f.glsl
+ *  @param width the texture width, must be power of 2
+ *  @param height the texture height, must be power of 2
+ *  @param tex the two ping-pong textures
+ *  @param readPos index (0 or 1) into tex holding the unsorted data
+ *  @param descending nonzero to sort in descending order of keys
+ *  @return index into tex holding the sorted data
+ *  @return -1 if width*height is not a power of 2 or exceeds 2^24, the largest
+ *          count the shader's float indices represent exactly; nothing is rendered
+ */
+int bitonicSort(GLuint prog, GLsizei width, GLsizei height, GLuint* tex, int readPos, int descending)
+{
+	const unsigned long long n = (unsigned long long)width * height;
+	if (width <= 0 || height <= 0 || (n & (n-1))) {
+		fprintf(stderr, "bitonicSort: %dx%d is not a power of 2 in size\n", width, height);
+		return -1;
+	};
+	if (n > (1u<<24)) {
+		// the shader computes indices in float, exact only up to 2^24
+		fprintf(stderr, "bitonicSort: %dx%d exceeds 2^24 texels\n", width, height);
+		return -1;
+	};
+	GLint texParam   = glGetUniformLocation(prog, "texture");
+	GLint widthParam = glGetUniformLocation(prog, "width");
+	GLint stageParam = glGetUniformLocation(prog, "stage");
+	GLint passParam  = glGetUniformLocation(prog, "pass");
+	GLint descParam  = glGetUniformLocation(prog, "descending");
+
+	glUseProgram(prog);
+	glUniform1f(widthParam, width);
+	glUniform1f(descParam, descending ? 1.0 : 0.0);
+	glActiveTexture(GL_TEXTURE0);
+	glUniform1i(texParam, 0);
+	// log2(n)*(log2(n)+1)/2 passes, each one full-screen compare-exchange
+	for (unsigned k=2; k<=n; k<<=1) {
+		glUniform1f(stageParam, k);
+		for (unsigned j=k>>1; j>0; j>>=1) {
+			glUniform1f(passParam, j);
+			glBindTexture(texTarget, tex[readPos]);
+			glDrawBuffer(ATTACHMENTPOINT[1-readPos]);
+			render(width, height);
+			readPos = 1-readPos;
+		};
+	};
+	return readPos;
+}
+
+/** Look up a percentile from a sorted FBO by reading back a single texel
+ *  @param attachpoint The attachment point to read
+ *  @param width Width of the FBO
+ *  @param height Height of the FBO
+ *  @param p the percentile in [0,1], in the order of the sort
+ *  @param texel destination to hold the floatPerTexel floats of the texel
+ *  @return the key, i.e. first channel, of the texel
+ */
+float sortedPercentile(GLenum attachpoint, GLsizei width, GLsizei height, double p, float*texel)
+{
+	unsigned n = (unsigned)width * (unsigned)height;
+	if (p < 0.0) p = 0.0;
+	if (p > 1.0) p = 1.0;
+	unsigned idx = (unsigned)floor(p * (n-1) + 0.5);
+	readFBORegion(attachpoint, idx % width, idx / width, 1, 1, texel);
+	return texel[0];
+}
+
+#ifdef GLSL_TRACE
+/* Call tracing ****************************************************************
+ * Counters are kept as a running total; each pass records a snapshot at
+ * traceBegin() and the difference at traceEnd(). Pass durations are taken on
+ * the CPU, i.e. time to issue the calls, and on the GPU with timestamp queries
+ * when ARB_timer_query is available; the queries are only resolved in
+ * traceReport() and traceWrite() so tracing does not stall the pipeline.
+ * Calls inside the wrappers are written as (glFoo)(...) so that they are not
+ * expanded by the macros in glsl_utils.h again.
+ */
+#ifdef GL_VERSION_3_3
+#define TRACE_TIMER_QUERY
+#endif
+#define TRACE_UNKNOWN	((GLuint)~0u)	// state not known, e.g. after glPopAttrib
+#define TRACE_UNITS		32				// texture units tracked for redundant binds
+enum {
+	TRACE_DRAW, TRACE_PROGRAM, TRACE_BIND_FBO, TRACE_BIND_TEXTURE, TRACE_DRAW_BUFFER,
+	TRACE_UNIFORM, TRACE_UPLOAD, TRACE_READBACK, TRACE_FINISH, TRACE_REDUNDANT,
+	TRACE_BYTES_UPLOAD, TRACE_BYTES_READBACK, TRACE_NCOUNTER
+};
+static const char* _traceName[TRACE_NCOUNTER] = {
+	"draw", "useProgram", "bindFBO", "bindTexture", "drawBuffer",
+	"uniform", "upload", "readback", "finish", "redundant",
+	"bytesUpload", "bytesReadback"
+};
+
+typedef struct {
+	char* name;			// pass name, or message for debug events
+	char phase;			// 'X' for a pass, 'i' for a debug message
+	double ts, dur;		// microseconds, CPU side
+	double gpuTs, gpuDur;	// microseconds, GPU side, valid if gpu == 2
+	int gpu;			// 0 = no queries, 1 = queries pending, 2 = resolved
+	GLuint query[2];	// timestamp queries at begin and end
+	unsigned long long count[TRACE_NCOUNTER];
+} TraceEvent;
+
+static unsigned long long _traceCount[TRACE_NCOUNTER];
+static TraceEvent* _traceEvent = NULL;
+static unsigned _traceEvents = 0, _traceCapacity = 0;
+static unsigned _traceStack[16];	// open passes, as index into _traceEvent
+static unsigned _traceDepth = 0;
+static double _traceStart = -1.0;
+static int _traceInit = 0;
+static int _traceHasDebug = 0, _traceHasTimer = 0;	// extensions, checked once in traceInit()
+static double _traceGpuOffset = 0.0;	// traceNow() when _traceGpuStart was taken
+static GLint64 _traceGpuStart = 0;		// GPU timestamp in nanoseconds
+// last bound state, for counting redundant changes
+static GLuint _lastProgram = TRACE_UNKNOWN, _lastFBO = TRACE_UNKNOWN;
+static GLenum _lastDrawBuffer = TRACE_UNKNOWN;
+static GLuint _lastTexture[TRACE_UNITS];
+static unsigned _activeUnit = 0;
+
+/** Microseconds since the first trace call */
+static double traceNow()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	double t = tv.tv_sec * 1e6 + tv.tv_usec;
+	if (_traceStart < 0) _traceStart = t;
+	return t - _traceStart;
+}
+
+/** Append an event and return its index, or -1 if out of memory */
+static int traceEvent(const char* name, char phase)
+{
+	if (_traceEvents == _traceCapacity) {
+		unsigned capacity = _traceCapacity ? 2*_traceCapacity : 256;
+		TraceEvent* ev = (TraceEvent*)realloc(_traceEvent, capacity*sizeof(TraceEvent));
+		if (!ev) return -1;
+		_traceEvent = ev;
+		_traceCapacity = capacity;
+	};
+	TraceEvent* ev = &_traceEvent[_traceEvents];
+	memset(ev, 0, sizeof(TraceEvent));
+	if ((ev->name = (char*)malloc(strlen(name)+1))) strcpy(ev->name, name);
+	ev->phase = phase;
+	ev->ts = traceNow();
+	return _traceEvents++;
+}
+
+/** Forget the draw buffer and texture bindings, e.g. after glPopAttrib restores them */
+static void traceForgetBindings()
+{
+	_lastDrawBuffer = TRACE_UNKNOWN;
+	for (unsigned i=0; i<TRACE_UNITS; ++i)
+		_lastTexture[i] = TRACE_UNKNOWN;
+}
+
+/** Bytes of a pixel rectangle for the given format and type */
+static unsigned long long traceBytes(GLsizei width, GLsizei height, GLenum format, GLenum type)
+{
+	unsigned channels, size;
+	switch(format) {
+		case GL_RGBA: channels = 4; break;
+		case GL_RGB: channels = 3; break;
+		case GL_LUMINANCE_ALPHA: channels = 2; break;
+		default: channels = 1;
+	};
+	switch(type) {
+		case GL_UNSIGNED_BYTE: case GL_BYTE: size = 1; break;
+		case GL_UNSIGNED_SHORT: case GL_SHORT: size = 2; break;
+		default: size = 4;
+	};
+	return (unsigned long long)width * height * channels * size;
+}
+
+/** Start a named pass, passes can be nested */
+void traceBegin(const char* name)
+{
+	if (_traceDepth == sizeof(_traceStack)/sizeof(_traceStack[0])) return;
+	int idx = traceEvent(name, 'X');
+	if (idx < 0) return;
+	memcpy(_traceEvent[idx].count, _traceCount, sizeof(_traceCount));
+	_traceStack[_traceDepth++] = idx;
+#ifdef TRACE_TIMER_QUERY
+	if (_traceHasTimer) {
+		glGenQueries(2, _traceEvent[idx].query);
+		glQueryCounter(_traceEvent[idx].query[0], GL_TIMESTAMP);
+	};
+#endif
+#ifdef GL_KHR_debug
+	if (_traceHasDebug)
+		glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+#endif
+}
+
+/** End the innermost pass. The GPU is not drained: the CPU duration is the
+ *  time to issue the pass and the GPU duration comes from timestamp queries.
+ */
+void traceEnd()
+{
+	if (!_traceDepth) return;
+#ifdef GL_KHR_debug
+	if (_traceHasDebug)
+		glPopDebugGroup();
+#endif
+	TraceEvent* ev = &_traceEvent[_traceStack[--_traceDepth]];
+	ev->dur = traceNow() - ev->ts;
+	for (unsigned i=0; i<TRACE_NCOUNTER; ++i)
+		ev->count[i] = _traceCount[i] - ev->count[i];
+#ifdef TRACE_TIMER_QUERY
+	if (ev->query[0]) {
+		glQueryCounter(ev->query[1], GL_TIMESTAMP);
+		ev->gpu = 1;
+	};
+#endif
+}
+
+/** Fetch the results of the timestamp queries of all ended passes
+ *  This waits for the GPU to reach the end of those passes.
+ */
+static void traceResolve()
+{
+#ifdef TRACE_TIMER_QUERY
+	for (unsigned e=0; e<_traceEvents; ++e) {
+		TraceEvent* ev = &_traceEvent[e];
+		if (ev->gpu != 1) continue;
+		GLuint64 t0, t1;
+		glGetQueryObjectui64v(ev->query[0], GL_QUERY_RESULT, &t0);
+		glGetQueryObjectui64v(ev->query[1], GL_QUERY_RESULT, &t1);
+		glDeleteQueries(2, ev->query);
+		ev->query[0] = ev->query[1] = 0;
+		ev->gpuTs = _traceGpuOffset + (double)((GLint64)t0 - _traceGpuStart) * 1e-3;
+		ev->gpuDur = (double)(t1 - t0) * 1e-3;
+		ev->gpu = 2;
+	};
+#endif
+}
+
+/** Print counter totals and per-pass counters to stderr */
+void traceReport()
+{
+	traceResolve();
+	fprintf(stderr, "GL call totals:\n");
+	for (unsigned i=0; i<TRACE_NCOUNTER; ++i)
+		fprintf(stderr, "  %-14s %llu\n", _traceName[i], _traceCount[i]);
+	for (unsigned e=0; e<_traceEvents; ++e) {
+		TraceEvent* ev = &_traceEvent[e];
+		if (ev->phase != 'X') continue;
+		fprintf(stderr, "pass %s: cpu %.0f us", ev->name ? ev->name : "", ev->dur);
+		if (ev->gpu == 2) fprintf(stderr, ", gpu %.0f us", ev->gpuDur);
+		for (unsigned i=0; i<TRACE_NCOUNTER; ++i)
+			if (ev->count[i]) fprintf(stderr, ", %s=%llu", _traceName[i], ev->count[i]);
+		fprintf(stderr, "\n");
+	};
+}
+
+/** Write a string as JSON string literal */
+static void traceJsonString(FILE* fp, const char* str)
+{
+	fputc('"', fp);
+	for (; str && *str; ++str) {
+		if (*str == '"' || *str == '\\') fprintf(fp, "\\%c", *str);
+		else if ((unsigned char)*str < 0x20) fprintf(fp, "\\u%04x", *str);
+		else fputc(*str, fp);
+	};
+	fputc('"', fp);
+}
+
+/** Write the recorded passes and debug messages in Chrome trace event format
+ *  The file can be loaded in chrome://tracing or Perfetto.
+ *  @param filename the JSON file to write
+ *  @return 0 on success, 1 otherwise
+ */
+int traceWrite(const char* filename)
+{
+	FILE* fp = fopen(filename, "w");
+	if (!fp) {
+		fprintf(stderr, "Error opening %s: ", filename); perror("");
+		return 1;
+	};
+	traceResolve();
+	// CPU issue time on thread 1, GPU execution time on thread 2
+	fprintf(fp, "{\"traceEvents\":[\n");
+	fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+	fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}");
+	for (unsigned e=0; e<_traceEvents; ++e) {
+		TraceEvent* ev = &_traceEvent[e];
+		if (ev->phase == 'X') {
+			fprintf(fp, ",\n{\"name\":");
+			traceJsonString(fp, ev->name);
+			fprintf(fp, ",\"cat\":\"gl\",\"ph\":\"X\",\"ts\":%.0f,\"dur\":%.0f,\"pid\":1,\"tid\":1,\"args\":{", ev->ts, ev->dur);
+			for (unsigned i=0; i<TRACE_NCOUNTER; ++i)
+				fprintf(fp, "%s\"%s\":%llu", i ? "," : "", _traceName[i], ev->count[i]);
+			fprintf(fp, "}}");
+			if (ev->gpu == 2) {
+				fprintf(fp, ",\n{\"name\":");
+				traceJsonString(fp, ev->name);
+				fprintf(fp, ",\"cat\":\"gpu\",\"ph\":\"X\",\"ts\":%.0f,\"dur\":%.0f,\"pid\":1,\"tid\":2}", ev->gpuTs, ev->gpuDur);
+			};
+		} else {
+			fprintf(fp, ",\n{\"name\":\"debug\",\"cat\":\"gl\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.0f,\"pid\":1,\"tid\":1,\"args\":{\"message\":", ev->ts);
+			traceJsonString(fp, ev->name);
+			fprintf(fp, "}}");
+		};
+	};
+	fprintf(fp, "\n]}\n");
+	return fclose(fp) ? 1 : 0;
+}
+
+#ifdef GL_KHR_debug
+static void APIENTRY traceDebugCallback(GLenum source, GLenum type, GLuint id, GLenum severity,
+                                        GLsizei length, const GLchar* message, const void* userParam)
+{
+	if (type == GL_DEBUG_TYPE_PUSH_GROUP || type == GL_DEBUG_TYPE_POP_GROUP) return;
+	traceEvent(message, 'i');
+	if (severity == GL_DEBUG_SEVERITY_HIGH)
+		fprintf(stderr, "GL debug: %s\n", message);
+}
+#endif
+
+/** Prepare tracing once a GL context exists, called by initGlut()
+ *  Checks the extensions once, records KHR_debug messages into the trace if
+ *  supported, and aligns the GPU timestamps with the CPU clock.
+ */
+void traceInit()
+{
+	if (_traceInit) return;
+	_traceInit = 1;
+	traceForgetBindings();
+#ifdef GL_KHR_debug
+	_traceHasDebug = glutExtensionSupported("GL_KHR_debug");
+	if (_traceHasDebug) {
+		glEnable(GL_DEBUG_OUTPUT);
+		glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);	// messages stay in order with the passes
+		glDebugMessageCallback(traceDebugCallback, NULL);
+	};
+#endif
+#ifdef TRACE_TIMER_QUERY
+	_traceHasTimer = glutExtensionSupported("GL_ARB_timer_query");
+	if (_traceHasTimer) {
+		_traceGpuOffset = traceNow();
+		glGetInteger64v(GL_TIMESTAMP, &_traceGpuStart);
+	};
+#endif
+}
+
+/* Wrappers of the GL calls, see the macros in glsl_utils.h */
+void traceUseProgram(GLuint program)
+{
+	++_traceCount[TRACE_PROGRAM];
+	if (program == _lastProgram) ++_traceCount[TRACE_REDUNDANT];
+	_lastProgram = program;
+	(glUseProgram)(program);
+}
+
+void traceBindFramebuffer(GLenum target, GLuint fbo)
+{
+	++_traceCount[TRACE_BIND_FBO];
+	if (fbo == _lastFBO) ++_traceCount[TRACE_REDUNDANT];
+	else _lastDrawBuffer = TRACE_UNKNOWN;	// draw buffer is per FBO state
+	_lastFBO = fbo;
+	(glBindFramebufferEXT)(target, fbo);
+}
+
+void traceDeleteFramebuffers(GLsizei n, const GLuint* fbo)
+{
+	for (GLsizei i=0; i<n; ++i)
+		if (fbo[i] == _lastFBO) {
+			// binding reverts to the window
+			_lastFBO = 0;
+			_lastDrawBuffer = TRACE_UNKNOWN;
+		};
+	(glDeleteFramebuffersEXT)(n, fbo);
+}
+
+void traceActiveTexture(GLenum unit)
+{
+	_activeUnit = unit - GL_TEXTURE0;
+	(glActiveTexture)(unit);
+}
+
+void traceBindTexture(GLenum target, GLuint tex)
+{
+	++_traceCount[TRACE_BIND_TEXTURE];
+	if (_activeUnit < TRACE_UNITS) {
+		if (tex == _lastTexture[_activeUnit]) ++_traceCount[TRACE_REDUNDANT];
+		_lastTexture[_activeUnit] = tex;
+	};
+	(glBindTexture)(target, tex);
+}
+
+void traceDeleteTextures(GLsizei n, const GLuint* tex)
+{
+	// deleted names may be reused by glGenTextures, so forget them
+	for (GLsizei i=0; i<n; ++i)
+		for (unsigned u=0; u<TRACE_UNITS; ++u)
+			if (_lastTexture[u] == tex[i]) _lastTexture[u] = TRACE_UNKNOWN;
+	(glDeleteTextures)(n, tex);
+}
+
+void tracePopAttrib()
+{
+	GLint unit;
+	traceForgetBindings();
+	(glPopAttrib)();
+	// GL_TEXTURE_BIT also restores the active unit
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &unit);
+	_activeUnit = unit - GL_TEXTURE0;
+}
+
+void traceDrawBuffer(GLenum buf)
+{
+	++_traceCount[TRACE_DRAW_BUFFER];
+	if (buf == _lastDrawBuffer) ++_traceCount[TRACE_REDUNDANT];
+	_lastDrawBuffer = buf;
+	(glDrawBuffer)(buf);
+}
+
+void traceUniform1f(GLint loc, GLfloat v0)
+{
+	++_traceCount[TRACE_UNIFORM];
+	(glUniform1f)(loc, v0);
+}
+
+void traceUniform1i(GLint loc, GLint v0)
+{
+	++_traceCount[TRACE_UNIFORM];
+	(glUniform1i)(loc, v0);
+}
+
+void traceUniform2f(GLint loc, GLfloat v0, GLfloat v1)
+{
+	++_traceCount[TRACE_UNIFORM];
+	(glUniform2f)(loc, v0, v1);
+}
+
+void traceGlBegin(GLenum mode)
+{
+	++_traceCount[TRACE_DRAW];
+	(glBegin)(mode);
+}
+
+void traceDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+	++_traceCount[TRACE_DRAW];
+	(glDrawArrays)(mode, first, count);
+}
+
+void traceTexSubImage2D(GLenum target, GLint level, GLint x, GLint y, GLsizei width, GLsizei height,
+                        GLenum format, GLenum type, const GLvoid* pixels)
+{
+	++_traceCount[TRACE_UPLOAD];
+	_traceCount[TRACE_BYTES_UPLOAD] += traceBytes(width, height, format, type);
+	(glTexSubImage2D)(target, level, x, y, width, height, format, type, pixels);
+}
+
+void traceReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, GLvoid* pixels)
+{
+	++_traceCount[TRACE_READBACK];
+	_traceCount[TRACE_BYTES_READBACK] += traceBytes(width, height, format, type);
+	(glReadPixels)(x, y, width, height, format, type, pixels);
+}
+
+void traceBufferData(GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage)
+{
+	// buffers allocated without data are filled by a later traced transfer
+	if (data) {
+		++_traceCount[TRACE_UPLOAD];
+		_traceCount[TRACE_BYTES_UPLOAD] += size;
+	};
+	(glBufferData)(target, size, data, usage);
+}
+
+void traceFinish()
+{
+	++_traceCount[TRACE_FINISH];
+	(glFinish)();
+}
+#endif /* GLSL_TRACE */
+
 /* vim:set noet sw=4 ts=4 bs=indent,eol,start syntax=c: */
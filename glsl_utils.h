@@ -41,10 +41,78 @@ int frameBufferStatus();
 int checkGLStatus();
 GLuint initGlut(int* argcp, char** argv);
 GLuint setupFBO(GLsizei width, GLsizei height, float**data, const unsigned count, GLuint*fbo, GLuint*tex);
+void uploadTexture(GLsizei width, GLsizei height, GLuint tex, const float*data);
 void readFBO(GLenum attachpoint, GLsizei width, GLsizei height, float*data);
+void readFBORegion(GLenum attachpoint, GLint x, GLint y, GLsizei width, GLsizei height, float*data);
+void readFBOLinear(GLenum attachpoint, GLsizei width, unsigned first, unsigned count, float*data);
+int readFBOStrided(GLuint prog, GLuint tex, GLsizei width, GLsizei height, GLsizei stride, float*data);
+int errorStats(GLuint prog, GLuint tex, GLuint refTex, GLsizei width, GLsizei height, double*maxError, double*avgError);
 int setupTexture(GLsizei width, GLsizei height, GLuint tex);
 void cleanupFBO(GLuint* fbo, GLuint* tex, const unsigned count);
+int beginScratchFBO(GLsizei width, GLsizei height, float**data, const unsigned count, GLuint*fbo, GLuint*tex, GLint*saved);
+void endScratchFBO(const GLint*saved, GLuint*fbo, GLuint*tex, const unsigned count);
 void render(GLsizei width, GLsizei height);
+void renderPoints(GLsizei width, GLsizei height);
+void cleanupPoints();
+void histogram(GLuint prog, GLsizei width, GLsizei height, GLuint texX, GLuint texY,
+               const GLsizei* bins, const float* lower, const float* upper);
+int bitonicSort(GLuint prog, GLsizei width, GLsizei height, GLuint* tex, int readPos, int descending);
+float sortedPercentile(GLenum attachpoint, GLsizei width, GLsizei height, double p, float*texel);
+
+/* Hot-path GL call tracing, compiled in with -DGLSL_TRACE (make TRACE=1).
+ * The GL calls below are redirected to wrappers in glsl_utils.c which count
+ * them before forwarding to the driver. Passes are delimited by traceBegin()
+ * and traceEnd(); without GLSL_TRACE these are no-ops. */
+#ifdef GLSL_TRACE
+void traceBegin(const char* name);
+void traceEnd();
+void traceReport();
+int traceWrite(const char* filename);
+void traceInit();
+
+void traceUseProgram(GLuint program);
+void traceBindFramebuffer(GLenum target, GLuint fbo);
+void traceDeleteFramebuffers(GLsizei n, const GLuint* fbo);
+void traceActiveTexture(GLenum unit);
+void traceBindTexture(GLenum target, GLuint tex);
+void traceDeleteTextures(GLsizei n, const GLuint* tex);
+void tracePopAttrib();
+void traceDrawBuffer(GLenum buf);
+void traceUniform1f(GLint loc, GLfloat v0);
+void traceUniform1i(GLint loc, GLint v0);
+void traceUniform2f(GLint loc, GLfloat v0, GLfloat v1);
+void traceGlBegin(GLenum mode);
+void traceDrawArrays(GLenum mode, GLint first, GLsizei count);
+void traceTexSubImage2D(GLenum target, GLint level, GLint x, GLint y, GLsizei width, GLsizei height,
+                        GLenum format, GLenum type, const GLvoid* pixels);
+void traceReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, GLvoid* pixels);
+void traceBufferData(GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage);
+void traceFinish();
+
+#define glUseProgram(p)                 traceUseProgram(p)
+#define glBindFramebufferEXT(t,f)       traceBindFramebuffer(t,f)
+#define glDeleteFramebuffersEXT(n,f)    traceDeleteFramebuffers(n,f)
+#define glActiveTexture(u)              traceActiveTexture(u)
+#define glBindTexture(t,x)              traceBindTexture(t,x)
+#define glDeleteTextures(n,x)           traceDeleteTextures(n,x)
+#define glPopAttrib()                   tracePopAttrib()
+#define glDrawBuffer(b)                 traceDrawBuffer(b)
+#define glUniform1f(l,a)                traceUniform1f(l,a)
+#define glUniform1i(l,a)                traceUniform1i(l,a)
+#define glUniform2f(l,a,b)              traceUniform2f(l,a,b)
+#define glBegin(m)                      traceGlBegin(m)
+#define glDrawArrays(m,f,c)             traceDrawArrays(m,f,c)
+#define glTexSubImage2D(t,l,x,y,w,h,f,ty,p) traceTexSubImage2D(t,l,x,y,w,h,f,ty,p)
+#define glReadPixels(x,y,w,h,f,ty,p)    traceReadPixels(x,y,w,h,f,ty,p)
+#define glBufferData(t,s,d,u)           traceBufferData(t,s,d,u)
+#define glFinish()                      traceFinish()
+#else
+#define traceBegin(name)                ((void)0)
+#define traceEnd()                      ((void)0)
+#define traceReport()                   ((void)0)
+#define traceWrite(filename)            (0)
+#define traceInit()                     ((void)0)
+#endif
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,132 @@
+/* Test script of OpenGL Shader Language for General Purpose Computing
+ *
+ * This code computes a 1D histogram of vector x and a 2D joint histogram of
+ * vectors (x,y) on the GPU. One point is rendered per input element into a
+ * bin texture with additive blending, so only the bins are read back.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <assert.h>
+#include "glsl_utils.h"
+
+/* bin index on CPU, same arithmetic as histogram.v.glsl; -1 if out of range */
+static int binOf(float v, float lower, float upper, int bins)
+{
+    if (v < lower || v > upper) return -1;
+    float b = floorf((v - lower) / (upper - lower) * bins);
+    return (b > bins-1) ? bins-1 : (int)b;
+}
+
+int main(int argc, char **argv) {
+    /* command line parameters */
+    int N, bins;                    // problem size, bins per dimension
+    int showResults;
+    /* application variables */
+    float *dataX, *dataY;           // data
+    float *gpu1d, *gpu2d;           // histograms from GPU
+    int *cpu1d, *cpu2d;             // histograms from CPU
+    double start, end;              // for timing
+    GLuint fbIn, fbBin, prog;       // FBO handles and program handle
+    GLuint texIn[2], texBin[2];     // textures handle
+    int texSize;
+
+    /* parse command line ***********/
+    if (argc < 4) {
+        printf("Command line parameters:\n");
+        printf("Param 1: problem size N\n");
+        printf("Param 2: number of bins per dimension\n");
+        printf("Param 3: 0 = print only mismatch count\n");
+        printf("         1 = print out the 1D histogram\n");
+        exit(0);
+    } else {
+        N = atoi(argv[1]);
+        bins = atoi(argv[2]);
+        showResults = atoi(argv[3]);
+        printf("N=%d, bins=%d, show=%d\n", N, bins, showResults);
+    }
+
+    /* setup parameters *************/
+    texSize = (int)sqrt((double)N);
+    N = texSize * texSize;
+    dataX = (float*)malloc(N*sizeof(float));
+    dataY = (float*)malloc(N*sizeof(float));
+    srand(0);
+    for (int i=0; i<N; i++) {
+        dataX[i] = rand() / (double)(RAND_MAX);
+        dataY[i] = 0.5 * (dataX[i] + rand() / (double)(RAND_MAX)); // correlated with x
+    }
+    const GLsizei binCount[] = {bins, bins};
+    const float lower[] = {0.0, 0.0};
+    const float upper[] = {1.0, 1.0};
+
+    /* initialize system ************/
+    GLuint hwnd = initGlut(&argc, argv);
+    float* data[] = {dataX, dataY};
+    GLuint fbo = setupFBO(texSize, texSize, data, 2, &fbIn, texIn);
+    assert(fbo == fbIn);
+    // bin textures: attachment 0 for 1D (row 0 only), attachment 1 for 2D
+    float* binData[] = {NULL, NULL};
+    fbo = setupFBO(bins, bins, binData, 2, &fbBin, texBin);
+    assert(fbo == fbBin);
+    prog = createProgram("histogram.v.glsl", "histogram.f.glsl");
+    glFinish();
+
+    /* histogram on GPU *************/
+    start = clock();
+    glDrawBuffer(ATTACHMENTPOINT[0]);
+    histogram(prog, texSize, texSize, texIn[0], 0, binCount, lower, upper);
+    glDrawBuffer(ATTACHMENTPOINT[1]);
+    histogram(prog, texSize, texSize, texIn[0], texIn[1], binCount, lower, upper);
+    glFinish();
+    end = clock();
+    printf("GPU time (s):\t\t\t%f\n", (end-start)/CLOCKS_PER_SEC);
+
+    gpu1d = (float*)malloc(bins*sizeof(float));
+    gpu2d = (float*)malloc(bins*bins*sizeof(float));
+    readFBO(ATTACHMENTPOINT[0], bins, 1, gpu1d);
+    readFBO(ATTACHMENTPOINT[1], bins, bins, gpu2d);
+    checkGLStatus();
+
+    /* histogram on CPU *************/
+    cpu1d = (int*)calloc(bins, sizeof(int));
+    cpu2d = (int*)calloc(bins*bins, sizeof(int));
+    start = clock();
+    for (int i=0; i<N; i++) {
+        int bx = binOf(dataX[i], lower[0], upper[0], bins);
+        int by = binOf(dataY[i], lower[1], upper[1], bins);
+        if (bx >= 0) cpu1d[bx]++;
+        if (bx >= 0 && by >= 0) cpu2d[by*bins+bx]++;
+    };
+    end = clock();
+    printf("CPU time (s):\t\t\t%f\n", (end-start)/CLOCKS_PER_SEC);
+
+    /* compare ***********************/
+    int mismatch1d = 0, mismatch2d = 0;
+    for (int i=0; i<bins; i++)
+        if ((int)gpu1d[i] != cpu1d[i]) mismatch1d++;
+    for (int i=0; i<bins*bins; i++)
+        if ((int)gpu2d[i] != cpu2d[i]) mismatch2d++;
+    printf("1D bins mismatched:\t\t%d of %d\n", mismatch1d, bins);
+    printf("2D bins mismatched:\t\t%d of %d\n", mismatch2d, bins*bins);
+    if (showResults) {
+        printf("BIN\tGPU\tCPU\n");
+        for (int i=0; i<bins; i++)
+            printf("%d\t%d\t%d\n", i, (int)gpu1d[i], cpu1d[i]);
+    };
+
+    /* clean up **********************/
+    glDeleteProgram(prog);
+    cleanupPoints();
+    cleanupFBO(&fbBin, texBin, 2);
+    cleanupFBO(&fbIn, texIn, 2);
+    glutDestroyWindow (hwnd);
+    free(dataX); free(dataY);
+    free(gpu1d); free(gpu2d);
+    free(cpu1d); free(cpu2d);
+    // exit
+    return 0;
+}
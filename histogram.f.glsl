@@ -0,0 +1,7 @@
+/* Each point adds one to its bin through GL_ONE/GL_ONE additive blending */
+void main(void)
+{
+    gl_FragColor = vec4(1.0, 1.0, 1.0, 1.0);
+}
+
+/* vim:set syntax=glsl sw=4 ts=4 bs=indent: */
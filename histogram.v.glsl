@@ -0,0 +1,30 @@
+#extension GL_ARB_texture_rectangle : enable
+
+uniform sampler2DRect textureX;
+uniform sampler2DRect textureY;
+uniform vec2 lower;         // lower bound of the bin range, per dimension
+uniform vec2 upper;         // upper bound of the bin range, per dimension
+uniform vec2 bins;          // number of bins, per dimension
+uniform float joint;        // 0 = 1D histogram of x, 1 = joint histogram of (x,y)
+
+/* Scatter one input element to its bin. Each vertex is the texel centre of an
+ * input element; the value is fetched from the texture and turned into a bin
+ * position. Elements outside [lower, upper] are moved outside the clip volume
+ * so that they are dropped; a value equal to upper falls into the last bin.
+ */
+void main(void)
+{
+    vec2 v = vec2(texture2DRect(textureX, gl_Vertex.xy).x, 0.0);
+    vec2 b = vec2(0.0, 0.0);
+    bool outside = v.x < lower.x || v.x > upper.x;
+    b.x = min(floor((v.x - lower.x) / (upper.x - lower.x) * bins.x), bins.x - 1.0);
+    if (joint > 0.5) {
+        v.y = texture2DRect(textureY, gl_Vertex.xy).x;
+        outside = outside || v.y < lower.y || v.y > upper.y;
+        b.y = min(floor((v.y - lower.y) / (upper.y - lower.y) * bins.y), bins.y - 1.0);
+    };
+    gl_Position = outside ? vec4(2.0, 2.0, 0.0, 1.0)
+                          : gl_ModelViewProjectionMatrix * vec4(b + 0.5, 0.0, 1.0);
+}
+
+/* vim:set syntax=glsl sw=4 ts=4 bs=indent: */
@@ -26,6 +26,7 @@ int main(int argc, char **argv) {
     GLint yParam, xParam, aParam;   // connection to params in GLSL
     int writePos=0;                 // ping-pong variable
     int texSize;
+    int stride = 1;                 // show every stride-th element per dimension
 
     /* parse command line ***********/
     if (argc < 5) {
@@ -37,6 +38,8 @@ int main(int argc, char **argv) {
         printf("         2 = compare and print out full result vectors (use with care for large N)\n");
         printf("Param 3: problem size N       \n");
         printf("Param 4: number of iterations \n");
+        printf("Param 5: (optional) with Param 2 = 2 or 3, only show every n-th element\n");
+        printf("         in both dimensions, subsampled on GPU before readback\n");
         exit(0);
     } else {
         mode = atoi(argv[1]);
@@ -50,6 +53,7 @@ int main(int argc, char **argv) {
         };
         N = atoi (argv[3]);
         iterations = atoi (argv[4]);
+        if (argc > 5 && atoi(argv[5]) > 1) stride = atoi(argv[5]);
         printf("N=%d, numIter=%d, show=%d, compare=%d\n", N, iterations, showResults, compareResults);
     }
 
@@ -69,6 +73,7 @@ int main(int argc, char **argv) {
 
     /* initialize system ************/
     GLuint hwnd = initGlut(&argc, argv);
+    traceBegin("setup");
     GLuint fbo = setupFBO(texSize, texSize, data, 3, &fb, tex);
     prog = createProgram(NULL, "linear_mapping.f.glsl");
     // Get hook to GLSL variables
@@ -81,8 +86,10 @@ int main(int argc, char **argv) {
     glBindTexture(texTarget, tex[2]);   // apply data X into texture 1
     glUniform1i(xParam, 1);             // use texture 1 as uniform sampler x
     glFinish();                         // flush GPU for more accurate timing
+    traceEnd();
 
     start = clock();
+    traceBegin("saxpy");
     /* perform calculation **********/
     for (int i=0; i<iterations; i++) {
         glDrawBuffer(ATTACHMENTPOINT[writePos]);    // set render destination
@@ -93,6 +100,7 @@ int main(int argc, char **argv) {
         writePos = 1-writePos;                      // swap the role of two textures for next iteration
     }
     glFinish();
+    traceEnd();
 
     end = clock();
     /* calculate FLOPS **************/
@@ -101,8 +109,24 @@ int main(int argc, char **argv) {
     printf("GPU MFLOP/s:\t\t\t%d\n",(int)mflops);
     // verify data
     if (!frameBufferStatus() && !checkGLStatus()) {
-        float* result = (float*)malloc(sizeof(float)*N);    // malloc and copy result from GPU
-        readFBO(ATTACHMENTPOINT[1-writePos], texSize, texSize, result);
+        // elements shown: all, or every stride-th in both dimensions
+        int showSize = (texSize + stride - 1) / stride;
+        float* result = NULL;
+        if (showResults) {
+            result = (float*)malloc(sizeof(float)*showSize*showSize);  // malloc and copy result from GPU
+            traceBegin("readback");
+            if (stride > 1) {
+                GLuint copyProg = createProgram(NULL, "strided_copy.f.glsl");
+                if (!copyProg || readFBOStrided(copyProg, tex[1-writePos], texSize, texSize, stride, result)) {
+                    fprintf(stderr, "Strided readback failed, not showing results\n");
+                    showResults = 0;
+                };
+                if (copyProg) glDeleteProgram(copyProg);
+            } else {
+                readFBO(ATTACHMENTPOINT[1-writePos], texSize, texSize, result);
+            };
+            traceEnd();
+        };
         if (compareResults)  {
             // verify with CPU
             start=clock();
@@ -113,32 +137,53 @@ int main(int argc, char **argv) {
             total = (end-start)/CLOCKS_PER_SEC;
             mflops = (2.0*N*iterations) / (total * 1e6);
             printf("CPU MFLOP/s:\t\t\t%d\n",(int)mflops);
-            // and compare results
-            double maxError = -1000.0;
+            // and compare results on GPU: CPU result goes into the free
+            // ping-pong texture, only max and avg error are read back
+            double maxError = 0.0;
             double avgError = 0.0;
-            for (int i=0; i<N; i++) {
-                double diff = fabs(result[i]-dataY[i]);
-                if (diff > maxError)
-                    maxError = diff;
-                avgError += diff;
-            }
-            avgError /= (double)N;
+            int gpuCompared = 0;
+            GLuint errProg = createProgram(NULL, "error_reduce.f.glsl");
+            if (errProg) {
+                traceBegin("compare");
+                uploadTexture(texSize, texSize, tex[writePos], dataY);
+                gpuCompared = !errorStats(errProg, tex[1-writePos], tex[writePos], texSize, texSize, &maxError, &avgError);
+                traceEnd();
+                glDeleteProgram(errProg);
+            };
+            if (!gpuCompared) {
+                // fall back to full readback and compare on CPU
+                fprintf(stderr, "GPU comparison failed, comparing on CPU\n");
+                float* full = (float*)malloc(sizeof(float)*N);
+                readFBO(ATTACHMENTPOINT[1-writePos], texSize, texSize, full);
+                maxError = avgError = 0.0;
+                for (int i=0; i<N; i++) {
+                    double diff = fabs(full[i]-dataY[i]);
+                    if (diff > maxError)
+                        maxError = diff;
+                    avgError += diff;
+                }
+                avgError /= (double)N;
+                free(full);
+            };
             printf("Max Error: \t\t\t%e\n",maxError);
             printf("Avg Error: \t\t\t%e\n",avgError);
             if (showResults) {
                 printf("GPU RESULTS\tCPU RESULTS:\n");
-                for (int i=0; i<N; i++) {
-                    printf("%f\t%f\t%f\n", result[i], dataY[i], result[i]-dataY[i]);
+                for (int i=0; i<showSize*showSize; i++) {
+                    int j = (i/showSize)*stride*texSize + (i%showSize)*stride;  // index into full vector
+                    printf("%f\t%f\t%f\n", result[i], dataY[j], result[i]-dataY[j]);
                 };
             }
         } else if (showResults) {
             // print out results
             printf("GPU RESULTS:\n");
-            for (int i=0; i<N; i++)
+            for (int i=0; i<showSize*showSize; i++)
                 printf("%f\n",result[i]);
         }
         free(result);
     };
+    traceReport();
+    traceWrite("linear_mapping.trace.json");
     // and clean up
     glDeleteProgram(prog);
     cleanupFBO(&fb, tex, 3);
@@ -59,7 +59,9 @@ int main(int argc, char **argv) {
     GLuint hwnd = initGlut(&argc, argv);
     // First two textures for ping-pong, third texture for input
     float* dataWrap[] = {NULL, data};
+    traceBegin("upload");
     GLuint fbo = setupFBO(size, size, dataWrap, 2, &fb, tex); // input texture
+    traceEnd();
     assert(fbo == fb);
     prog = createProgram(NULL, "max_reduce.f.glsl");
     texParam   = glGetUniformLocation(prog, "texture");
@@ -69,6 +71,7 @@ int main(int argc, char **argv) {
     /* perform calculation in loop ***/
     int outSize = size >> 1;
     while (outSize) {
+        traceBegin("reduce");
         glUniform1f(deltaParam, outSize);           // bind use outSize as offset, outSize >= 1
         glActiveTexture(GL_TEXTURE1);               // select texture1
         glBindTexture(texTarget, tex[1-writePos]);  // apply data into texture 1
@@ -77,14 +80,20 @@ int main(int argc, char **argv) {
         render(outSize, outSize);                   // run GLSL program
         outSize >>= 1;                              // Set output size to half for next iteration
         writePos = 1-writePos;                      // swap the role of two textures for next iteration
+        traceEnd();
     };
     glFinish();
 
     float result;
+    traceBegin("readback");
     readFBO(ATTACHMENTPOINT[1-writePos], 1, 1, &result);
+    traceEnd();
     printf("Maximum  = %f\n", result);
     printf("Expected = %f\n", expected);
 
+    traceReport();
+    traceWrite("max_reduce.trace.json");
+
     /* clean up **********************/
     glDeleteProgram(prog);
     cleanupFBO(&fb, tex, 2);
@@ -0,0 +1,12 @@
+#extension GL_ARB_texture_rectangle : enable
+
+uniform sampler2DRect texture;
+uniform float stride;
+
+/* Gather every stride-th texel in both dimensions into a smaller texture */
+void main(void)
+{
+    gl_FragColor = texture2DRect(texture, floor(gl_TexCoord[0].st) * stride + vec2(0.5, 0.5));
+}
+
+/* vim:set syntax=glsl sw=4 ts=4 bs=indent: */